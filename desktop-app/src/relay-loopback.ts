@@ -0,0 +1,271 @@
+/**
+ * Loopback test of the network relay.
+ *
+ * Sends gamepad frames from a RelaySender to a RelayReceiver over 127.0.0.1, through a
+ * small UDP proxy that drops, delays and reorders packets. For each latency target it
+ * reports the end to end latency of released frames and how the delivered frames are
+ * distributed (gaps between released sequence numbers and why the rest were dropped).
+ *
+ * It then runs checks on the JitterBuffer with synthetic arrival times, and on the
+ * sockets (clean link, latency target vs late drops, restarted sender). Any failed
+ * check sets a non-zero exit code.
+ *
+ *   npm run relay-loopback -- --frames=500 --interval=8 --loss=0.05 --jitter=15 --reorder=0.05 --targets=0,10,20,40
+ */
+
+import dgram from "dgram";
+import { FRAME_SIZE, JitterBuffer, JitterBufferStats, RelayPacket, RelayReceiver, RelaySender, SESSION_TIMEOUT_MS, now } from "./relay";
+
+interface LoopbackOptions {
+    frames: number;
+    interval: number;
+    loss: number;
+    delay: number;
+    jitter: number;
+    reorder: number;
+    seed: number;
+    targets: number[];
+}
+
+const parseOptions = (): LoopbackOptions => {
+    const args = new Map(process.argv.slice(2)
+        .filter(arg => arg.startsWith("--"))
+        .map(arg => arg.slice(2).split("=") as [string, string]));
+    const number = (name: string, fallback: number) => args.has(name) ? Number(args.get(name)) : fallback;
+
+    return {
+        frames: number("frames", 500),
+        interval: number("interval", 8),
+        loss: number("loss", 0.05),
+        delay: number("delay", 5),
+        jitter: number("jitter", 15),
+        reorder: number("reorder", 0.05),
+        seed: number("seed", 1),
+        targets: (args.get("targets") ?? "0,10,20,40").split(",").map(Number),
+    };
+}
+
+// Small seeded PRNG (mulberry32) so runs with the same options are comparable
+const random = (seed: number) => () => {
+    seed = (seed + 0x6D2B79F5) | 0;
+    let t = Math.imul(seed ^ (seed >>> 15), 1 | seed);
+    t = (t + Math.imul(t ^ (t >>> 7), 61 | t)) ^ t;
+    return ((t ^ (t >>> 14)) >>> 0) / 4294967296;
+}
+
+const percentile = (sorted: number[], p: number): number => {
+    if (sorted.length === 0) return NaN;
+    return sorted[Math.min(sorted.length - 1, Math.floor(sorted.length * p))];
+}
+
+const sleep = (ms: number) => new Promise(resolve => setTimeout(resolve, ms));
+
+// Forwards datagrams to the receiver after a random delay, dropping some of them and
+// holding a few back long enough to land behind their successors
+const startImpairment = (options: LoopbackOptions, receiverPort: number) => {
+    const rng = random(options.seed);
+    const socket = dgram.createSocket("udp4");
+    const counters = { forwarded: 0, lost: 0 };
+
+    socket.on("message", message => {
+        if (rng() < options.loss) {
+            counters.lost++;
+            return;
+        }
+        let delay = options.delay + rng() * options.jitter;
+        if (rng() < options.reorder) delay += options.interval * 2 + options.jitter;
+
+        setTimeout(() => {
+            counters.forwarded++;
+            socket.send(message, receiverPort, "127.0.0.1");
+        }, delay);
+    });
+
+    return new Promise<{ port: number, counters: typeof counters, close: () => void }>(resolve => {
+        socket.bind(0, "127.0.0.1", () => resolve({
+            port: socket.address().port,
+            counters,
+            close: () => socket.close(),
+        }));
+    });
+}
+
+const check = (name: string, passed: boolean, detail = "") => {
+    console.log(`  ${passed ? "pass" : "FAIL"}  ${name}${detail ? ` (${detail})` : ""}`);
+    if (!passed) process.exitCode = 1;
+}
+
+interface RunResult {
+    stats: JitterBufferStats;
+    lost: number;
+    latencies: number[];
+    delivered: number[];
+}
+
+const run = async (options: LoopbackOptions, targetLatencyMs: number): Promise<RunResult> => {
+    const sendTimes = new Map<number, number>();
+    const latencies: number[] = [];
+    const delivered: number[] = [];
+
+    const receiver = new RelayReceiver(0, { targetLatencyMs }, packet => {
+        latencies.push(now() - sendTimes.get(packet.seq));
+        delivered.push(packet.seq);
+    });
+    const impairment = await startImpairment(options, await receiver.listening);
+    const sender = new RelaySender("127.0.0.1", impairment.port);
+    await sender.ready;
+
+    const frame = Buffer.alloc(FRAME_SIZE);
+    const start = now();
+    for (let seq = 0; seq < options.frames; seq++) {
+        frame.writeUInt32LE(seq, FRAME_SIZE - 4);
+        sendTimes.set(seq, now());
+        sender.send(frame);
+
+        // Pace against the start time so timer drift does not stretch the run
+        await sleep(Math.max(0, start + (seq + 1) * options.interval - now()));
+    }
+    await sleep(options.delay + options.jitter * 2 + options.interval * 2 + targetLatencyMs + 100);
+
+    sender.close();
+    impairment.close();
+    receiver.close();
+
+    return { stats: receiver.stats(), lost: impairment.counters.lost, latencies, delivered };
+}
+
+const report = (options: LoopbackOptions, targetLatencyMs: number, result: RunResult) => {
+    const { stats, lost, latencies, delivered } = result;
+    const sorted = [...latencies].sort((a, b) => a - b);
+    const gaps = new Map<string, number>();
+    delivered.slice(1).forEach((seq, i) => {
+        const gap = seq - delivered[i];
+        const bucket = gap >= 4 ? "4+" : String(gap);
+        gaps.set(bucket, (gaps.get(bucket) ?? 0) + 1);
+    });
+
+    const ms = (value: number) => value.toFixed(1).padStart(6);
+    const share = (count: number) => `${count} (${(100 * count / options.frames).toFixed(1)}%)`;
+    console.log(`target ${targetLatencyMs}ms (adaptive delay settled at ${stats.delayMs.toFixed(1)}ms)`);
+    console.log(`  latency ms   min ${ms(sorted[0])}  p50 ${ms(percentile(sorted, 0.5))}  p95 ${ms(percentile(sorted, 0.95))}  p99 ${ms(percentile(sorted, 0.99))}  max ${ms(sorted[sorted.length - 1])}`);
+    console.log(`  frames       sent ${options.frames}  delivered ${share(stats.released)}  lost ${share(lost)}`);
+    console.log(`  dropped      late ${share(stats.late)}  superseded ${share(stats.superseded)}  rejected ${share(stats.rejected)}`);
+    console.log(`  reordered    ${share(stats.reordered)} arrived out of order but were queued in time`);
+    console.log(`  seq gaps     ${["1", "2", "3", "4+"].map(bucket => `${bucket}: ${gaps.get(bucket) ?? 0}`).join("  ")}`);
+}
+
+// Drives a JitterBuffer directly, one packet every 20ms of synthetic time
+const checkJitterBuffer = () => {
+    console.log("jitter buffer");
+    const frame = Buffer.alloc(FRAME_SIZE);
+    const packet = (session: number, seq: number, timestamp: number): RelayPacket => ({ session, seq, timestamp, frame });
+
+    let buffer = new JitterBuffer({ targetLatencyMs: 0 });
+    const released: number[] = [];
+    for (let seq = 0; seq < 50; seq++) {
+        buffer.push(packet(1, seq, seq * 20), 1000 + seq * 20);
+        released.push(buffer.pop(1000 + seq * 20)?.seq);
+    }
+    check("steady stream is released in order", released.every((seq, i) => seq === i));
+    check("steady stream adds no delay", buffer.stats().delayMs === 0);
+
+    // With 20ms of playout delay, seq 2 arrives 25ms late and behind seq 3, but
+    // still before it is due
+    buffer = new JitterBuffer({ targetLatencyMs: 40, minLatencyMs: 20 });
+    const order: number[] = [];
+    buffer.push(packet(1, 0, 0), 0);
+    buffer.push(packet(1, 1, 20), 20);
+    order.push(buffer.pop(20)?.seq);
+    order.push(buffer.pop(40)?.seq);
+    buffer.push(packet(1, 3, 60), 60);
+    buffer.push(packet(1, 2, 40), 65);
+    order.push(buffer.pop(65)?.seq);
+    order.push(buffer.pop(80)?.seq);
+    check("reordered packet within the target is released in order", order.join() === "0,1,2,3", order.join());
+    check("reordered packet is counted", buffer.stats().reordered === 1 && buffer.stats().late === 0);
+
+    // seq 1 arrives after seq 2 has already been released
+    buffer = new JitterBuffer({ targetLatencyMs: 0 });
+    buffer.push(packet(1, 0, 0), 0);
+    buffer.push(packet(1, 2, 40), 40);
+    buffer.pop(40);
+    buffer.push(packet(1, 1, 20), 45);
+    check("packet older than the released one is dropped as late", buffer.stats().late === 1 && buffer.pop(45) === undefined);
+
+    // a second sender while the first is active, then a restart from seq 0 after silence
+    buffer = new JitterBuffer({ targetLatencyMs: 0 });
+    for (let seq = 0; seq < 10; seq++) {
+        buffer.push(packet(1, seq, seq * 20), seq * 20);
+        buffer.pop(seq * 20);
+    }
+    buffer.push(packet(2, 0, 5000), 200);
+    check("other session is rejected while the sender is active", buffer.stats().rejected === 1 && buffer.pop(200) === undefined);
+    const restart = 180 + SESSION_TIMEOUT_MS;
+    buffer.push(packet(2, 0, 5000), restart);
+    check("restarted sender from seq 0 is delivered after silence", buffer.pop(restart)?.seq === 0);
+    buffer.push(packet(1, 10, 200), restart + 1);
+    check("old session cannot take back control", buffer.stats().rejected === 2 && buffer.pop(restart + 1) === undefined);
+}
+
+// A restarted sender (new session, seq from 0) over real sockets
+const checkRestartedSender = async (options: LoopbackOptions) => {
+    const sessions = new Map<number, number[]>();
+    const receiver = new RelayReceiver(0, { targetLatencyMs: 0 }, packet => {
+        sessions.set(packet.session, [...(sessions.get(packet.session) ?? []), packet.seq]);
+    });
+    const port = await receiver.listening;
+
+    const frame = Buffer.alloc(FRAME_SIZE);
+    for (const pause of [0, SESSION_TIMEOUT_MS + 100]) {
+        await sleep(pause);
+        const sender = new RelaySender("127.0.0.1", port);
+        await sender.ready;
+        for (let i = 0; i < 20; i++) {
+            sender.send(frame);
+            await sleep(options.interval);
+        }
+        sender.close();
+    }
+    await sleep(50);
+    receiver.close();
+
+    const [first, second] = [...sessions.values()];
+    check("restarted sender is delivered", second !== undefined && second[0] <= 1 && second.length >= 15,
+        `${first?.length ?? 0} then ${second?.length ?? 0} frames`);
+}
+
+const main = async () => {
+    const options = parseOptions();
+    console.log(`Relay loopback: ${options.frames} frames every ${options.interval}ms, ` +
+        `${options.loss * 100}% loss, ${options.delay}ms + up to ${options.jitter}ms jitter, ` +
+        `${options.reorder * 100}% held back for reordering`);
+
+    const results: RunResult[] = [];
+    for (const target of options.targets) {
+        const result = await run(options, target);
+        report(options, target, result);
+        results.push(result);
+    }
+
+    checkJitterBuffer();
+
+    console.log("loopback");
+    const clean = await run({ ...options, frames: 200, loss: 0, delay: 0, jitter: 0, reorder: 0 }, 0);
+    check("clean link has no late drops", clean.stats.late === 0, `${clean.stats.late} late`);
+    check("clean link delivers nearly every frame", clean.stats.released >= 190, `${clean.stats.released} of 200`);
+
+    const lowest = options.targets.indexOf(Math.min(...options.targets));
+    const highest = options.targets.indexOf(Math.max(...options.targets));
+    if (options.jitter > 0 && lowest !== highest) {
+        const [low, high] = [results[lowest].stats.late, results[highest].stats.late];
+        check("late drops go down as the latency target goes up", high < low,
+            `${low} late at ${options.targets[lowest]}ms, ${high} at ${options.targets[highest]}ms`);
+    }
+
+    await checkRestartedSender(options);
+}
+
+main().catch(error => {
+    console.error(error);
+    process.exit(1);
+});
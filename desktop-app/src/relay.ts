@@ -0,0 +1,322 @@
+/**
+ * Network relay for gamepad frames.
+ *
+ * A remote client sends the same 8 byte frame that normally goes to the serial port
+ * (4 axes + 4 button bytes) over UDP, prefixed with a session id, a sequence number
+ * and a send timestamp. The machine holding the serial port feeds those packets through an
+ * adaptive jitter buffer and forwards whatever frame is due to the ESP32.
+ *
+ * Only the newest controller state matters, so a frame that arrives after a newer one
+ * has already gone out is dropped instead of being replayed, and queued frames are
+ * skipped whenever a newer one is due.
+ *
+ * There is no authentication. The receiver listens on localhost unless given another
+ * address, and anyone who can reach that address can drive the controller while no
+ * other sender is active.
+ */
+
+import dgram from "dgram";
+
+export const FRAME_SIZE = 8;
+export const DEFAULT_RELAY_PORT = 7331;
+export const DEFAULT_RELAY_BIND_ADDRESS = "127.0.0.1";
+
+const PACKET_MAGIC = 0x52;
+// magic (u8) + session (u32) + sequence (u32) + send timestamp in ms (u32)
+const HEADER_SIZE = 13;
+export const PACKET_SIZE = HEADER_SIZE + FRAME_SIZE;
+
+// Number of recent packets used to estimate the network delay spread
+const TRANSIT_WINDOW = 64;
+// Fraction of packets the playout delay should absorb
+const TRANSIT_QUANTILE = 0.95;
+// How long the current sender must be silent before another session may take over
+export const SESSION_TIMEOUT_MS = 500;
+
+export interface RelayPacket {
+    // Picked at random by each sender, so a restarted sender is a new session
+    session: number;
+    seq: number;
+    timestamp: number;
+    frame: Buffer;
+}
+
+// Monotonic clock in milliseconds, only ever compared against itself
+export const now = (): number => {
+    const [seconds, nanoseconds] = process.hrtime();
+    return seconds * 1000 + nanoseconds / 1e6;
+}
+
+// Signed distance between two wrapping 32 bit counters
+const wrapDiff = (a: number, b: number): number => (a - b) | 0;
+
+export const encodePacket = (session: number, seq: number, timestamp: number, frame: Buffer): Buffer => {
+    const packet = Buffer.alloc(PACKET_SIZE);
+    packet.writeUInt8(PACKET_MAGIC, 0);
+    packet.writeUInt32LE(session >>> 0, 1);
+    packet.writeUInt32LE(seq >>> 0, 5);
+    packet.writeUInt32LE(timestamp >>> 0, 9);
+    frame.copy(packet, HEADER_SIZE, 0, FRAME_SIZE);
+    return packet;
+}
+
+export const decodePacket = (message: Buffer): RelayPacket | undefined => {
+    if (message.length !== PACKET_SIZE || message.readUInt8(0) !== PACKET_MAGIC) return undefined;
+    return {
+        session: message.readUInt32LE(1),
+        seq: message.readUInt32LE(5),
+        timestamp: message.readUInt32LE(9),
+        frame: Buffer.from(message.subarray(HEADER_SIZE)),
+    };
+}
+
+export interface JitterBufferOptions {
+    // Upper bound on the delay the buffer may add. Higher values ride out more
+    // network jitter (smoother input), lower values keep input snappier.
+    targetLatencyMs: number;
+    // Delay that is always added, even on a perfectly steady link
+    minLatencyMs?: number;
+}
+
+export interface JitterBufferStats {
+    received: number;
+    released: number;
+    // Arrived after the same or a newer frame had already been released
+    late: number;
+    // From another session while the current sender was still active
+    rejected: number;
+    // Arrived behind a newer frame, but early enough to be queued in order
+    reordered: number;
+    // Queued, but a newer frame became due first
+    superseded: number;
+    // Delay currently added on top of the fastest observed transit
+    delayMs: number;
+}
+
+interface QueuedPacket {
+    packet: RelayPacket;
+    dueAt: number;
+}
+
+export class JitterBuffer {
+    private targetLatencyMs: number;
+    private minLatencyMs: number;
+    private queue: QueuedPacket[] = [];
+    private transits: number[] = [];
+    private releasedSeq: number | undefined;
+    private session: number | undefined;
+    private sessionLastArrival = 0;
+    private delayMs = 0;
+    private counters = { received: 0, released: 0, late: 0, rejected: 0, reordered: 0, superseded: 0 };
+
+    constructor(options: JitterBufferOptions) {
+        this.setOptions(options);
+        this.delayMs = this.minLatencyMs;
+    }
+
+    // Takes effect from the next packet, queued frames keep their due time
+    setOptions(options: JitterBufferOptions): void {
+        this.targetLatencyMs = Math.max(0, options.targetLatencyMs);
+        this.minLatencyMs = Math.min(this.targetLatencyMs, Math.max(0, options.minLatencyMs ?? 0));
+    }
+
+    stats(): JitterBufferStats {
+        return { ...this.counters, delayMs: this.delayMs };
+    }
+
+    push(packet: RelayPacket, arrival: number): void {
+        this.counters.received++;
+
+        if (packet.session !== this.session) {
+            // Only one sender drives the controller at a time. Another one (a restarted
+            // client, or stragglers from the one it replaced) waits for it to go quiet.
+            if (this.session !== undefined && arrival - this.sessionLastArrival < SESSION_TIMEOUT_MS) {
+                this.counters.rejected++;
+                return;
+            }
+            // A new sender starts its sequence and clock from scratch
+            this.session = packet.session;
+            this.queue = [];
+            this.transits = [];
+            this.releasedSeq = undefined;
+        }
+        this.sessionLastArrival = arrival;
+
+        if (this.releasedSeq !== undefined && wrapDiff(packet.seq, this.releasedSeq) <= 0) {
+            this.counters.late++;
+            return;
+        }
+        if (this.queue.some(entry => entry.packet.seq === packet.seq)) {
+            this.counters.late++;
+            return;
+        }
+
+        // Sender and receiver clocks are unrelated, so only differences in transit
+        // time mean anything. The fastest recent packet defines zero queueing delay.
+        const transit = wrapDiff(Math.floor(arrival), packet.timestamp);
+        this.transits.push(transit);
+        if (this.transits.length > TRANSIT_WINDOW) this.transits.shift();
+
+        const sorted = [...this.transits].sort((a, b) => a - b);
+        const baseTransit = sorted[0];
+        const spread = sorted[Math.floor((sorted.length - 1) * TRANSIT_QUANTILE)] - baseTransit;
+        this.delayMs = Math.min(this.targetLatencyMs, Math.max(this.minLatencyMs, spread));
+
+        // When the packet would have arrived on an uncongested link, plus the playout delay
+        const dueAt = arrival - (transit - baseTransit) + this.delayMs;
+        // Keep the queue in sequence order so pop() can treat later entries as newer
+        const index = this.queue.findIndex(entry => wrapDiff(entry.packet.seq, packet.seq) > 0);
+        if (index < 0) {
+            this.queue.push({ packet, dueAt });
+        } else {
+            this.counters.reordered++;
+            this.queue.splice(index, 0, { packet, dueAt });
+        }
+    }
+
+    // Earliest time at which pop() will return a frame
+    nextDue(): number | undefined {
+        if (this.queue.length === 0) return undefined;
+        return Math.min(...this.queue.map(entry => entry.dueAt));
+    }
+
+    // Releases the newest due frame and discards everything older than it
+    pop(time: number): RelayPacket | undefined {
+        let index = -1;
+        this.queue.forEach((entry, i) => {
+            if (entry.dueAt <= time) index = i;
+        });
+        if (index < 0) return undefined;
+
+        const packet = this.queue[index].packet;
+        this.counters.superseded += index;
+        this.counters.released++;
+        this.queue = this.queue.slice(index + 1);
+        this.releasedSeq = packet.seq;
+        return packet;
+    }
+}
+
+export interface RelayReceiverOptions extends JitterBufferOptions {
+    // Local address to listen on, DEFAULT_RELAY_BIND_ADDRESS if not given. Use a LAN
+    // address (or 0.0.0.0) to accept a remote sender.
+    bindAddress?: string;
+}
+
+export class RelaySender {
+    private readonly socket = dgram.createSocket("udp4");
+    private readonly session = Math.floor(Math.random() * 0x100000000) >>> 0;
+    private seq = 0;
+    private connected = false;
+    private closed = false;
+    // Resolves once the host has resolved and send() will transmit. Rejects if it
+    // could not be resolved.
+    readonly ready: Promise<void>;
+
+    // onError is called once if the socket fails (e.g. the host does not resolve),
+    // after which the sender is closed and send() does nothing
+    constructor(host: string, port: number, onError?: (error: Error) => void) {
+        this.socket.on("error", error => {
+            // Errors can keep arriving after close (e.g. DNS lookups still in flight)
+            if (this.closed) return;
+            console.error("Relay sender error:", error);
+            this.close();
+            onError?.(error);
+        });
+        // Resolve the host once. Sending to a hostname would do a lookup per packet,
+        // and lookups finishing out of order put packets on the wire out of sequence.
+        // Listened for separately: a connect callback would swallow lookup errors
+        this.ready = new Promise((resolve, reject) => {
+            this.socket.once("connect", () => {
+                this.connected = true;
+                resolve();
+            });
+            this.socket.once("error", reject);
+        });
+        // Callers that only use onError should not see an unhandled rejection
+        this.ready.catch(() => undefined);
+        this.socket.connect(port, host);
+    }
+
+    // Frames sent before the host has resolved are dropped, only the newest state matters
+    send(frame: Buffer): void {
+        if (this.closed || !this.connected) return;
+        const packet = encodePacket(this.session, this.seq, Math.floor(now()), frame);
+        this.socket.send(packet);
+        this.seq = (this.seq + 1) >>> 0;
+    }
+
+    close(): void {
+        if (this.closed) return;
+        this.closed = true;
+        this.socket.close();
+    }
+}
+
+export class RelayReceiver {
+    private readonly socket = dgram.createSocket("udp4");
+    private readonly buffer: JitterBuffer;
+    private timer: ReturnType<typeof setTimeout> | undefined;
+    private closed = false;
+    // Resolves with the bound port, useful when constructed with port 0. Rejects
+    // if the port could not be bound.
+    readonly listening: Promise<number>;
+
+    // onError is called once if the socket fails (e.g. the port is already in use),
+    // after which the receiver is closed
+    constructor(port: number, options: RelayReceiverOptions, private readonly onFrame: (packet: RelayPacket) => void,
+                onError?: (error: Error) => void) {
+        this.buffer = new JitterBuffer(options);
+        this.listening = new Promise((resolve, reject) => {
+            this.socket.once("listening", () => resolve(this.socket.address().port));
+            this.socket.once("error", reject);
+        });
+        // Callers that only use onError should not see an unhandled rejection
+        this.listening.catch(() => undefined);
+        this.socket.on("error", error => {
+            // Errors can keep arriving after close (e.g. DNS lookups still in flight)
+            if (this.closed) return;
+            console.error("Relay receiver error:", error);
+            this.close();
+            onError?.(error);
+        });
+        this.socket.on("message", message => {
+            const packet = decodePacket(message);
+            if (packet === undefined) return;
+            this.buffer.push(packet, now());
+            this.schedule();
+        });
+        this.socket.bind(port, options.bindAddress ?? DEFAULT_RELAY_BIND_ADDRESS);
+    }
+
+    stats(): JitterBufferStats {
+        return this.buffer.stats();
+    }
+
+    setOptions(options: JitterBufferOptions): void {
+        this.buffer.setOptions(options);
+    }
+
+    close(): void {
+        if (this.closed) return;
+        this.closed = true;
+        if (this.timer !== undefined) clearTimeout(this.timer);
+        this.timer = undefined;
+        this.socket.close();
+    }
+
+    private schedule(): void {
+        if (this.timer !== undefined) clearTimeout(this.timer);
+        this.timer = undefined;
+
+        const due = this.buffer.nextDue();
+        if (due === undefined || this.closed) return;
+        this.timer = setTimeout(() => this.release(), Math.max(0, due - now()));
+    }
+
+    private release(): void {
+        const packet = this.buffer.pop(now());
+        if (packet !== undefined) this.onFrame(packet);
+        this.schedule();
+    }
+}
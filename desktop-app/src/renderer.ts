@@ -29,6 +29,7 @@
 import './index.css';
 import SerialPort from "serialport";
 import { dialog } from "electron";
+import { DEFAULT_RELAY_PORT, RelayPacket, RelayReceiver, RelaySender } from "./relay";
 
 console.log("Initialising");
 
@@ -96,11 +97,7 @@ const refreshControllers = () => {
 
 const axisBuffer = Buffer.alloc(4);
 const buttonBuffer = Buffer.alloc(4);
-let serialPort: SerialPort;
-const readController = () => {
-    if (selectedControllerPort == undefined) return;
-    console.log('Sending');
-
+const readFrame = (): Buffer => {
     const gamepad = navigator.getGamepads()[selectedControllerPort];
     const axes = gamepad.axes.map(axes => Math.round((axes + 1) / 2 * 255));
     axes.forEach((axe, index) => axisBuffer[index] = axe)
@@ -112,11 +109,82 @@ const readController = () => {
         buttonBuffer[i] = (buttonBuffer[i] & ~(1 << (index % 8))) | (button << (index % 8))
     })
 
-    const toSend = Buffer.concat([axisBuffer, buttonBuffer])
+    return Buffer.concat([axisBuffer, buttonBuffer])
+}
+
+let serialPort: SerialPort;
+const writeSerial = (frame: Buffer) => {
+    if (selectedSerialPort === undefined) return;
     if (serialPort === undefined) {
         serialPort = new SerialPort(selectedSerialPort.path, { baudRate: 115200 })
     }
-    serialPort.write(toSend);
+    serialPort.write(frame);
+}
+
+// "local" drives the serial port from a gamepad on this machine, "send" relays the
+// gamepad to a remote machine and "receive" drives the serial port from a remote one
+let relayMode = "local";
+let relaySender: RelaySender;
+let relayReceiver: RelayReceiver;
+const readController = () => {
+    if (relayMode === "receive") return;
+    if (selectedControllerPort == undefined) return;
+    console.log('Sending');
+
+    const frame = readFrame();
+    if (relayMode === "send") {
+        relaySender?.send(frame);
+    } else {
+        writeSerial(frame);
+    }
+}
+
+const relayLatencyOptions = () => ({ targetLatencyMs: Math.max(0, Number(relayLatencyInput.value) || 0) });
+
+// Only a change of mode, host or port needs new sockets. A new sender also means
+// a new session on the receiving end, so it is not recreated needlessly.
+let relayEndpoint: string;
+const startRelay = () => {
+    const mode = relayModeDiv.value;
+    const port = Number(relayPortInput.value) || DEFAULT_RELAY_PORT;
+    // the remote host when sending, the local address to listen on when receiving
+    const host = relayHostInput.value;
+    const endpoint = `${mode} ${host} ${port}`;
+    if (endpoint === relayEndpoint) {
+        relayReceiver?.setOptions(relayLatencyOptions());
+        return;
+    }
+    relayEndpoint = endpoint;
+    relayModeDiv.title = "";
+
+    relaySender?.close();
+    relaySender = undefined;
+    relayReceiver?.close();
+    relayReceiver = undefined;
+
+    relayMode = mode;
+    console.log(`Relay mode ${relayMode} on port ${port}`);
+
+    // Each relay reports failure against the endpoint it was started for
+    const onError = (error: Error) => relayFailed(endpoint, mode, error);
+    if (relayMode === "send") {
+        relaySender = new RelaySender(host, port, onError);
+    } else if (relayMode === "receive") {
+        relayReceiver = new RelayReceiver(port, { ...relayLatencyOptions(), bindAddress: host }, (packet: RelayPacket) => writeSerial(packet.frame), onError);
+    }
+}
+
+// A failed relay socket is already closed, fall back to the local controller
+// so the mode shown matches what is actually running
+const relayFailed = (endpoint: string, mode: string, error: Error) => {
+    // A relay that has since been replaced must not undo the newly chosen mode
+    if (endpoint !== relayEndpoint) return;
+
+    const message = `Relay ${mode} failed: ${error.message}`;
+    console.error(`${message}, switching to local controller`);
+    relayModeDiv.value = "local";
+    startRelay();
+    relayModeDiv.title = message;
 }
 
 const serialPortsDiv = document.getElementById('serialports') as HTMLSelectElement;
@@ -144,4 +212,14 @@ refreshControllerButton.addEventListener('click', () => {
 })
 refreshControllers();
 
+const relayModeDiv = document.getElementById('relaymode') as HTMLSelectElement;
+const relayHostInput = document.getElementById('relayhost') as HTMLInputElement;
+const relayPortInput = document.getElementById('relayport') as HTMLInputElement;
+const relayLatencyInput = document.getElementById('relaylatency') as HTMLInputElement;
+relayPortInput.value = String(DEFAULT_RELAY_PORT);
+[relayModeDiv, relayHostInput, relayPortInput, relayLatencyInput].forEach(element => {
+    element.addEventListener('change', () => startRelay());
+})
+startRelay();
+
 setInterval(readController, 20);
\ No newline at end of file
@@ -0,0 +1,48 @@
+//
+//  Boot phase timing
+//
+
+#include "boot_phase.h"
+
+#include <string.h>
+
+static const char* const sequence[] = {
+    BOOT_PHASE_APP_MAIN,      BOOT_PHASE_UART,      BOOT_PHASE_NVS,
+    BOOT_PHASE_BT_ADDRESS,    BOOT_PHASE_BT_CONTROLLER,
+    BOOT_PHASE_BLUEDROID,     BOOT_PHASE_HID,       BOOT_PHASE_LED,
+    BOOT_PHASE_DISCOVERABLE,
+};
+
+static boot_phase_t phases[BOOT_PHASE_MAX];
+static size_t phase_count = 0;
+
+void boot_phase_mark(const char* name, int64_t time_us) {
+    if (phase_count >= BOOT_PHASE_MAX) return;
+    phases[phase_count].name = name;
+    phases[phase_count].time_us = time_us;
+    phase_count++;
+}
+
+size_t boot_phase_count(void) { return phase_count; }
+
+const boot_phase_t* boot_phase_get(size_t index) {
+    if (index >= phase_count) return NULL;
+    return &phases[index];
+}
+
+int64_t boot_phase_duration_us(size_t index) {
+    if (index >= phase_count) return 0;
+    if (index == 0) return phases[0].time_us;
+    return phases[index].time_us - phases[index - 1].time_us;
+}
+
+int boot_phase_check_sequence(void) {
+    for (size_t i = 0; i < phase_count; i++) {
+        if (i >= sizeof(sequence) / sizeof(sequence[0]) ||
+            strcmp(phases[i].name, sequence[i]) != 0)
+            return (int)i;
+    }
+    return -1;
+}
+
+void boot_phase_reset(void) { phase_count = 0; }
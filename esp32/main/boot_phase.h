@@ -0,0 +1,54 @@
+//
+//  Boot phase timing
+//
+//  Records a timestamp at the end of each startup step so the time to
+//  "discoverable" can be reported and checked. Times count from when esp_timer
+//  starts, after the ROM and second stage bootloader have run.
+//
+//  Kept free of ESP-IDF dependencies: callers pass in the clock value
+//  (esp_timer_get_time() on the device), so this also builds on the host.
+//
+
+#ifndef BOOT_PHASE_H
+#define BOOT_PHASE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define BOOT_PHASE_MAX 16
+
+// Startup steps, in the order app_main() marks them
+#define BOOT_PHASE_APP_MAIN "app_main"
+#define BOOT_PHASE_UART "uart"
+#define BOOT_PHASE_NVS "nvs"
+#define BOOT_PHASE_BT_ADDRESS "bt_address"
+#define BOOT_PHASE_BT_CONTROLLER "bt_controller"
+#define BOOT_PHASE_BLUEDROID "bluedroid"
+#define BOOT_PHASE_HID "hid"
+#define BOOT_PHASE_LED "led"
+#define BOOT_PHASE_DISCOVERABLE "discoverable"
+
+typedef struct {
+    const char* name;
+    int64_t time_us;
+} boot_phase_t;
+
+// Record that the phase called name finished at time_us. Marks past
+// BOOT_PHASE_MAX are ignored.
+void boot_phase_mark(const char* name, int64_t time_us);
+
+size_t boot_phase_count(void);
+const boot_phase_t* boot_phase_get(size_t index);
+
+// Time spent in the phase at index, i.e. since the previous mark (or since
+// esp_timer started for the first one)
+int64_t boot_phase_duration_us(size_t index);
+
+// Index of the first mark that is out of the order above, or -1 if the marks
+// recorded so far follow it
+int boot_phase_check_sequence(void);
+
+// Forget all marks
+void boot_phase_reset(void);
+
+#endif
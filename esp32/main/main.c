@@ -30,7 +30,14 @@
 
 #include <led_strip.h>
 
+#include "boot_phase.h"
+
 #define LED_GPIO 2
+// 4 axes followed by 4 bytes of button bits, see desktop-app/src/renderer.ts
+#define INPUT_FRAME_SIZE 8
+// Well under the 20ms between frames, so a read that times out with nothing
+// new has hit the gap between frames and the next byte starts a frame
+#define INPUT_FRAME_TIMEOUT_MS 8
 
 // Status LED
 static const rgb_t black = { .r = 0x00, .g = 0x00, .b = 0x00 };
@@ -60,7 +67,7 @@ TaskHandle_t SendingHandle = NULL;
 TaskHandle_t BlinkHandle = NULL;
 uint8_t timer = 0;
 
-static void get_buttons() {
+static void uart_init() {
     /* Configure parameters of an UART driver,
      * communication pins and install the driver */
     uart_config_t uart_config = {
@@ -75,15 +82,29 @@ static void get_buttons() {
     ESP_ERROR_CHECK(uart_driver_install(0, 1024 * 2, 0, 0, NULL, 0));
     ESP_ERROR_CHECK(uart_param_config(0, &uart_config));
     ESP_ERROR_CHECK(uart_set_pin(0, 1, 3, UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE));
+}
 
-    // Configure a temporary buffer for the incoming data
-    uint8_t *data = (uint8_t *) malloc(1024);
+static void get_buttons() {
+    uint8_t data[INPUT_FRAME_SIZE];
+    int have = 0;
 
     while (1) {
-        // Read data from the UART
-        int len = uart_read_bytes(0, data, 1024, 100);
-        if (len <= 0) continue;
-
+        // Take the next whole frame as soon as it arrives, keeping partial reads
+        // that straddle the timeout
+        int len = uart_read_bytes(0, data + have, INPUT_FRAME_SIZE - have,
+                                  pdMS_TO_TICKS(INPUT_FRAME_TIMEOUT_MS));
+        if (len <= 0) {
+            // The line went idle, so any partial frame held was the tail of one
+            // we joined midway (e.g. after a watchdog reset). Realign on the
+            // next frame.
+            have = 0;
+            continue;
+        }
+        have += len;
+        if (have < INPUT_FRAME_SIZE) continue;
+        have = 0;
+
+        xSemaphoreTake(xSemaphore, portMAX_DELAY);
         lx_send = data[0];
         ly_send = 255 - data[1];
         cx_send = data[2];
@@ -103,8 +124,7 @@ static void get_buttons() {
                     // ((data[4] >> 0) & 1) << 7);
         lt_send = (data[4] >> 7) & 1;
         rt_send = (data[4] >> 8) & 1;
-
-        vTaskDelay(6);  // 6ms between sample
+        xSemaphoreGive(xSemaphore);
     }
 }
 
@@ -347,8 +367,10 @@ void connection_cb(esp_bd_addr_t bd_addr, esp_hidd_connection_state_t state) {
                                      ESP_BT_NON_DISCOVERABLE);
 
             // clear blinking LED - solid
-            vTaskDelete(BlinkHandle);
-            BlinkHandle = NULL;
+            if (BlinkHandle != NULL) {
+                vTaskDelete(BlinkHandle);
+                BlinkHandle = NULL;
+            }
             ESP_ERROR_CHECK(led_strip_set_pixel(&strip, 0, black));
             ESP_ERROR_CHECK(led_strip_flush(&strip));
 
@@ -512,10 +534,12 @@ esp_err_t set_bt_address() {
 
         size_t addr_size = sizeof(bt_addr);
         err = nvs_set_blob(my_handle, "mac_addr", bt_addr, addr_size);
+        // only a newly generated address needs writing to flash
+        if (err == ESP_OK) err = nvs_commit(my_handle);
     }
 
-    err = nvs_commit(my_handle);
     nvs_close(my_handle);
+    if (err != ESP_OK) return err;
     esp_base_mac_addr_set(bt_addr);
 
     // put mac addr in switch pairing packet
@@ -534,6 +558,40 @@ void print_bt_address() {
              bd_addr[5]);
 }
 
+static const char* reset_reason_name(esp_reset_reason_t reason) {
+    switch (reason) {
+        case ESP_RST_POWERON: return "power on";
+        case ESP_RST_EXT: return "external pin";
+        case ESP_RST_SW: return "software";
+        case ESP_RST_PANIC: return "panic";
+        case ESP_RST_INT_WDT: return "interrupt watchdog";
+        case ESP_RST_TASK_WDT: return "task watchdog";
+        case ESP_RST_WDT: return "other watchdog";
+        case ESP_RST_DEEPSLEEP: return "deep sleep";
+        case ESP_RST_BROWNOUT: return "brownout";
+        case ESP_RST_SDIO: return "sdio";
+        default: return "unknown";
+    }
+}
+
+// print how long each startup step took, measured from when esp_timer started
+// (ROM and bootloader time before that is not included)
+void print_boot_phases() {
+    const char* TAG = "boot";
+
+    ESP_LOGI(TAG, "reset reason: %s", reset_reason_name(esp_reset_reason()));
+    for (size_t i = 0; i < boot_phase_count(); i++) {
+        const boot_phase_t* phase = boot_phase_get(i);
+        ESP_LOGI(TAG, "%-14s at %8" PRId64 " us (+%" PRId64 " us)", phase->name,
+                 phase->time_us, boot_phase_duration_us(i));
+    }
+
+    int out_of_order = boot_phase_check_sequence();
+    if (out_of_order >= 0) {
+        ESP_LOGW(TAG, "boot phase %d is out of sequence", out_of_order);
+    }
+}
+
 #define SPP_TAG "tag"
 static void esp_bt_gap_cb(esp_bt_gap_cb_event_t event,
                           esp_bt_gap_cb_param_t* param) {
@@ -570,23 +628,22 @@ static void esp_bt_gap_cb(esp_bt_gap_cb_event_t event,
 
 void app_main() {
     const char* TAG = "app_main";
+    boot_phase_mark(BOOT_PHASE_APP_MAIN, esp_timer_get_time());
 
-    // ESP_LOGI(TAG, "app main started");
+    // The input path only needs the UART and the button state mutex, so bring
+    // it up first and accept frames while the radio is still starting
+    xSemaphore = xSemaphoreCreateMutex();
+    uart_init();
+    // drop whatever the host streamed while we were resetting
+    uart_flush_input(0);
     xTaskCreatePinnedToCore(get_buttons, "gbuttons", 2048, NULL, 1, NULL, 1);
-
-    led_strip_install();
-    ESP_ERROR_CHECK(led_strip_init(&strip));
-
-    ESP_ERROR_CHECK(led_strip_set_pixel(&strip, 0, white));
-    ESP_ERROR_CHECK(led_strip_flush(&strip));
+    boot_phase_mark(BOOT_PHASE_UART, esp_timer_get_time());
 
     esp_err_t ret;
     static esp_hidd_callbacks_t callbacks;
     static esp_hidd_app_param_t app_param;
     static esp_hidd_qos_param_t both_qos;
 
-    xSemaphore = xSemaphoreCreateMutex();
-
     app_param.name = "BlueCubeMod";
     app_param.description = "BlueCubeMod Example";
     app_param.provider = "ESP32";
@@ -610,14 +667,14 @@ void app_main() {
         ret = nvs_flash_init();
     }
     ESP_ERROR_CHECK(ret);
+    boot_phase_mark(BOOT_PHASE_NVS, esp_timer_get_time());
 
-    ESP_LOGI(TAG, "setting bt address");
     ret = set_bt_address();
     if (ret != ESP_OK) {
         ESP_LOGE(TAG, "set bt address failed: %s\n", esp_err_to_name(ret));
         return;
     }
-    ESP_LOGI(TAG, "set bt address");
+    boot_phase_mark(BOOT_PHASE_BT_ADDRESS, esp_timer_get_time());
 
     ESP_ERROR_CHECK(esp_bt_controller_mem_release(ESP_BT_MODE_BLE));
 
@@ -633,6 +690,7 @@ void app_main() {
         ESP_LOGE(TAG, "enable controller failed: %s\n", esp_err_to_name(ret));
         return;
     }
+    boot_phase_mark(BOOT_PHASE_BT_CONTROLLER, esp_timer_get_time());
 
     if ((ret = esp_bluedroid_init()) != ESP_OK) {
         ESP_LOGE(TAG, "initialize bluedroid failed: %s\n",
@@ -644,38 +702,33 @@ void app_main() {
         ESP_LOGE(TAG, "enable bluedroid failed: %s\n", esp_err_to_name(ret));
         return;
     }
+    boot_phase_mark(BOOT_PHASE_BLUEDROID, esp_timer_get_time());
 
+    esp_bt_gap_register_callback(esp_bt_gap_cb);
+    esp_hid_device_register_app(&app_param, &both_qos, &both_qos);
+    esp_hid_device_init(&callbacks);
+    esp_bt_dev_set_device_name("Pro Controller");
+
+    // set once the hid device is up, so its class of device is the one advertised
     esp_bt_cod_t cod = {
         .service = 0b00000000001,
         .major = 0b00101,
         .minor = 0b0010,
     };
     esp_bt_gap_set_cod(cod, ESP_BT_INIT_COD);
+    boot_phase_mark(BOOT_PHASE_HID, esp_timer_get_time());
 
-    esp_bt_gap_register_callback(esp_bt_gap_cb);
-    ESP_LOGI(TAG, "setting hid parameters");
-
-    esp_hid_device_register_app(&app_param, &both_qos, &both_qos);
-
-    ESP_LOGI(TAG, "starting hid device");
-    esp_hid_device_init(&callbacks);
-
-    ESP_LOGI(TAG, "setting device name");
-    esp_bt_dev_set_device_name("Pro Controller");
+    // The status LED is not needed to connect, so it waits for the radio. It
+    // has to be ready before we are discoverable as connection_cb drives it.
+    led_strip_install();
+    ESP_ERROR_CHECK(led_strip_init(&strip));
+    xTaskCreate(blink_led, "blink_task", 1024, NULL, 1, &BlinkHandle);
+    boot_phase_mark(BOOT_PHASE_LED, esp_timer_get_time());
 
-    ESP_LOGI(TAG, "setting to connectable, discoverable");
     esp_bt_gap_set_scan_mode(ESP_BT_CONNECTABLE, ESP_BT_GENERAL_DISCOVERABLE);
+    boot_phase_mark(BOOT_PHASE_DISCOVERABLE, esp_timer_get_time());
 
+    // Logging blocks on the UART, so it all happens once we are discoverable
+    print_boot_phases();
     print_bt_address();
-    esp_bt_gap_set_cod(cod, ESP_BT_INIT_COD);
-
-    esp_bt_cod_t cod2;
-    esp_bt_gap_get_cod(&cod2);
-
-    ESP_LOGI(TAG, "%d", cod2.major);
-    ESP_LOGI(TAG, "%d", cod2.minor);
-    ESP_LOGI(TAG, "%d", cod2.service);
-
-    // start blinking
-    xTaskCreate(blink_led, "blink_task", 1024, NULL, 1, &BlinkHandle);
 }
@@ -0,0 +1,90 @@
+//
+//  Host tests for boot phase timing
+//
+
+// the checks below are the test, keep them in any build type
+#undef NDEBUG
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "boot_phase.h"
+
+// Same marks, in the same order, as app_main()
+static void mark_boot_sequence(void) {
+    boot_phase_mark(BOOT_PHASE_APP_MAIN, 310000);
+    boot_phase_mark(BOOT_PHASE_UART, 311200);
+    boot_phase_mark(BOOT_PHASE_NVS, 335000);
+    boot_phase_mark(BOOT_PHASE_BT_ADDRESS, 336100);
+    boot_phase_mark(BOOT_PHASE_BT_CONTROLLER, 420000);
+    boot_phase_mark(BOOT_PHASE_BLUEDROID, 610000);
+    boot_phase_mark(BOOT_PHASE_HID, 640000);
+    boot_phase_mark(BOOT_PHASE_LED, 641000);
+    boot_phase_mark(BOOT_PHASE_DISCOVERABLE, 645000);
+}
+
+static void test_mark_order(void) {
+    boot_phase_reset();
+    mark_boot_sequence();
+
+    assert(boot_phase_count() == 9);
+    assert(strcmp(boot_phase_get(0)->name, BOOT_PHASE_APP_MAIN) == 0);
+    assert(strcmp(boot_phase_get(1)->name, BOOT_PHASE_UART) == 0);
+    assert(strcmp(boot_phase_get(8)->name, BOOT_PHASE_DISCOVERABLE) == 0);
+    assert(boot_phase_get(9) == NULL);
+    assert(boot_phase_check_sequence() == -1);
+}
+
+static void test_out_of_order(void) {
+    boot_phase_reset();
+    boot_phase_mark(BOOT_PHASE_APP_MAIN, 100);
+    boot_phase_mark(BOOT_PHASE_NVS, 200);
+    boot_phase_mark(BOOT_PHASE_UART, 300);
+    assert(boot_phase_check_sequence() == 1);
+
+    // a partial boot that stopped early is still in order
+    boot_phase_reset();
+    boot_phase_mark(BOOT_PHASE_APP_MAIN, 100);
+    boot_phase_mark(BOOT_PHASE_UART, 200);
+    assert(boot_phase_check_sequence() == -1);
+
+    // marks past the end of the sequence are out of order too
+    boot_phase_reset();
+    mark_boot_sequence();
+    boot_phase_mark("extra", 700000);
+    assert(boot_phase_check_sequence() == 9);
+}
+
+static void test_max_phases(void) {
+    boot_phase_reset();
+    for (int i = 0; i < BOOT_PHASE_MAX + 4; i++) boot_phase_mark("phase", i);
+
+    assert(boot_phase_count() == BOOT_PHASE_MAX);
+    assert(boot_phase_get(BOOT_PHASE_MAX - 1)->time_us == BOOT_PHASE_MAX - 1);
+    assert(boot_phase_get(BOOT_PHASE_MAX) == NULL);
+}
+
+static void test_durations(void) {
+    boot_phase_reset();
+    mark_boot_sequence();
+
+    // the first phase runs from when esp_timer started, not from reset
+    assert(boot_phase_duration_us(0) == 310000);
+    assert(boot_phase_duration_us(1) == 1200);
+    assert(boot_phase_duration_us(5) == 190000);
+    assert(boot_phase_duration_us(8) == 4000);
+    assert(boot_phase_duration_us(9) == 0);
+
+    int64_t total = 0;
+    for (size_t i = 0; i < boot_phase_count(); i++) total += boot_phase_duration_us(i);
+    assert(total == boot_phase_get(8)->time_us);
+}
+
+int main(void) {
+    test_mark_order();
+    test_out_of_order();
+    test_max_phases();
+    test_durations();
+    puts("boot_phase_test passed");
+    return 0;
+}
@@ -0,0 +1,15 @@
+# Checks that app_main() in main.c marks the boot phases in the order
+# boot_phase.c expects, i.e. the order of the BOOT_PHASE_* names in boot_phase.h.
+file(READ "${MAIN_DIR}/main.c" main_source)
+file(READ "${MAIN_DIR}/boot_phase.h" header_source)
+
+string(REGEX MATCHALL "#define BOOT_PHASE_[A-Z_]+ \"" expected "${header_source}")
+string(REGEX REPLACE "#define (BOOT_PHASE_[A-Z_]+) \"" "\\1" expected "${expected}")
+
+string(REGEX MATCHALL "boot_phase_mark\\(BOOT_PHASE_[A-Z_]+" marked "${main_source}")
+string(REPLACE "boot_phase_mark(" "" marked "${marked}")
+
+if(NOT marked STREQUAL expected)
+  message(FATAL_ERROR "app_main marks\n  ${marked}\nbut boot_phase.h expects\n  ${expected}")
+endif()
+message(STATUS "app_main marks all boot phases in order")